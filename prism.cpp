@@ -16,19 +16,394 @@
 #include <fstream>
 #include <stdexcept>
 #include <cstdlib>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <deque>
+#include <sstream>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <unistd.h>
 
 #define WIDTH 800
 #define HEIGHT 600
 #define BACKGROUND {{{0.037, 0.017f, 0.069f, 1.0f}}}
 #define MAX_FRAMES_IN_FLIGHT 2
+#define STARTUP_TRACE_FILE "startup_trace.json"
+#define WINDOW_TITLE "prism_engine"
+#define STATS_HISTORY 240 // Cantidad de frames que se guardan en el historial de tiempos
+#define STATS_REFRESH 0.5 // Segundos entre lecturas de memoria y actualizaciones del overlay
+#define STATS_PORT 9464 // Endpoint HTTP local (solo escucha en 127.0.0.1)
+#define STATS_OVERLAY_KEY GLFW_KEY_F3
+#define MAX_TIMED_PASSES 8 // Pasadas con timestamps de GPU por frame
+#define OCCLUSION_CULLING false // Culling en dos fases con piramide de profundidad (requiere compilar los .comp con shaders/compile_shaders.sh)
+
+// Se inicializa antes de main, asi que sirve como referencia del inicio del proceso
+static const auto processStart = std::chrono::steady_clock::now();
+
+// Registra el arranque del motor en formato Chrome trace (se abre con chrome://tracing o ui.perfetto.dev)
+class StartupTrace
+{
+  public:
+    StartupTrace (void)
+    {
+      threads[std::this_thread::get_id()] = 0; // El hilo que crea el trace es el principal
+    }
+    void record (const std::string& name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if(finished) return; // Despues del primer present no se registra nada (ej: al recrear la swapchain)
+      events.push_back({ name, 'X', threadIndex(), toMicros(start), toMicros(end) - toMicros(start) });
+    }
+    void instant (const std::string& name)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if(finished) return;
+      events.push_back({ name, 'i', threadIndex(), toMicros(std::chrono::steady_clock::now()), 0 });
+    }
+    void write (const std::string& filename)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      finished = true;
+
+      std::ofstream file(filename);
+      if(!file.is_open())
+      {
+        std::cerr << "AVISO: No se pudo escribir el trace de arranque " << filename << std::endl;
+        return;
+      }
+      file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << std::endl;
+      for(const auto& [id, index] : threads)
+      {
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << index
+             << ",\"args\":{\"name\":\"" << (index == 0 ? "main" : "worker " + std::to_string(index)) << "\"}}," << std::endl;
+      }
+      for(size_t i = 0; i < events.size(); i++)
+      {
+        const Event& event = events[i];
+        file << "{\"name\":\"" << event.name << "\",\"cat\":\"startup\",\"ph\":\"" << event.phase
+             << "\",\"pid\":1,\"tid\":" << event.thread << ",\"ts\":" << event.start;
+        if(event.phase == 'X') file << ",\"dur\":" << event.duration;
+        else file << ",\"s\":\"g\"";
+        file << "}" << (i + 1 < events.size() ? "," : "") << std::endl;
+      }
+      file << "]}" << std::endl;
+      std::cout << "Trace de arranque guardado en " << filename << std::endl;
+    }
+  private:
+    struct Event { std::string name; char phase; int thread; long long start; long long duration; };
+    std::mutex mutex;
+    std::vector<Event> events;
+    std::map<std::thread::id, int> threads;
+    bool finished = false;
+
+    int threadIndex (void) // Asume que el mutex ya esta tomado
+    {
+      auto it = threads.find(std::this_thread::get_id());
+      if(it != threads.end()) return it->second;
+      int index = static_cast<int>(threads.size());
+      threads[std::this_thread::get_id()] = index;
+      return index;
+    }
+    static long long toMicros (std::chrono::steady_clock::time_point time)
+    {
+      return std::chrono::duration_cast<std::chrono::microseconds>(time - processStart).count();
+    }
+};
+
+// Mide el tiempo desde su creacion hasta que sale del scope
+class TraceScope
+{
+  public:
+    TraceScope (StartupTrace& trace, std::string name) : trace(trace), name(std::move(name)), start(std::chrono::steady_clock::now()) {}
+    ~TraceScope (void) { trace.record(name, start, std::chrono::steady_clock::now()); }
+  private:
+    StartupTrace& trace;
+    std::string name;
+    std::chrono::steady_clock::time_point start;
+};
+
+// Telemetria del motor. La escribe el hilo de render y la lee el servidor de estadisticas
+class EngineStats
+{
+  public:
+    struct FrameCounters { uint32_t draws = 0; uint64_t triangles = 0; uint32_t pipelineBinds = 0; uint64_t stagingBytes = 0; };
+    struct PassTiming { std::string name; double gpuMs; };
+    struct HeapInfo { uint64_t size; uint64_t usage; uint64_t budget; bool deviceLocal; };
+
+    void addDevice (const std::string& name, int score)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      devices.push_back({ name, score });
+    }
+    void setSelectedDevice (const std::string& name)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      selectedDevice = name;
+    }
+    void endFrame (double frameMs, const FrameCounters& counters)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      history.push_back({ frameMs, counters.stagingBytes });
+      if(history.size() > STATS_HISTORY) history.pop_front();
+      lastCounters = counters;
+      totalStagingBytes += counters.stagingBytes;
+      frameCount++;
+    }
+    void setPassTimings (std::vector<PassTiming> timings)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      passTimings = std::move(timings);
+    }
+    void setHeaps (std::vector<HeapInfo> newHeaps, bool budgetSupported)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      heaps = std::move(newHeaps);
+      memoryBudgetSupported = budgetSupported;
+    }
+    std::string toJson (void)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      FrameTimeSummary frameTime = summarizeFrameTimes();
+      std::ostringstream out;
+
+      out << "{\"device\":\"" << escape(selectedDevice) << "\",\"devices\":[";
+      for(size_t i = 0; i < devices.size(); i++)
+      {
+        out << (i ? "," : "") << "{\"name\":\"" << escape(devices[i].name) << "\",\"score\":" << devices[i].score << "}";
+      }
+      out << "],\"frames\":" << frameCount;
+      out << ",\"frameTime\":{\"lastMs\":" << frameTime.last << ",\"avgMs\":" << frameTime.avg << ",\"minMs\":" << frameTime.min << ",\"maxMs\":" << frameTime.max << ",\"historyMs\":[";
+      for(size_t i = 0; i < history.size(); i++) out << (i ? "," : "") << history[i].frameMs;
+      out << "]},\"passes\":[";
+      for(size_t i = 0; i < passTimings.size(); i++)
+      {
+        out << (i ? "," : "") << "{\"name\":\"" << escape(passTimings[i].name) << "\",\"gpuMs\":" << passTimings[i].gpuMs << "}";
+      }
+      out << "],\"counters\":{\"draws\":" << lastCounters.draws << ",\"triangles\":" << lastCounters.triangles << ",\"pipelineBinds\":" << lastCounters.pipelineBinds << "}";
+      out << ",\"staging\":{\"totalBytes\":" << totalStagingBytes << ",\"bytesPerSecond\":" << stagingBytesPerSecond() << "}";
+      out << ",\"memory\":{\"budgetSupported\":" << (memoryBudgetSupported ? "true" : "false") << ",\"heaps\":[";
+      for(size_t i = 0; i < heaps.size(); i++)
+      {
+        out << (i ? "," : "") << "{\"index\":" << i << ",\"deviceLocal\":" << (heaps[i].deviceLocal ? "true" : "false") << ",\"size\":" << heaps[i].size;
+        // Sin VK_EXT_memory_budget el uso y el presupuesto son desconocidos, no 0
+        if(memoryBudgetSupported) out << ",\"usage\":" << heaps[i].usage << ",\"budget\":" << heaps[i].budget << "}";
+        else out << ",\"usage\":null,\"budget\":null}";
+      }
+      out << "]}}" << std::endl;
+      return out.str();
+    }
+    std::string toPrometheus (void) // Formato de texto de Prometheus, para /metrics
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      FrameTimeSummary frameTime = summarizeFrameTimes();
+      std::ostringstream out;
+
+      out << "# TYPE prism_frames_total counter\nprism_frames_total " << frameCount << "\n";
+      out << "# TYPE prism_frame_time_ms gauge\n";
+      out << "prism_frame_time_ms{stat=\"last\"} " << frameTime.last << "\n";
+      out << "prism_frame_time_ms{stat=\"avg\"} " << frameTime.avg << "\n";
+      out << "prism_frame_time_ms{stat=\"min\"} " << frameTime.min << "\n";
+      out << "prism_frame_time_ms{stat=\"max\"} " << frameTime.max << "\n";
+      out << "# TYPE prism_pass_gpu_time_ms gauge\n";
+      for(const auto& pass : passTimings) out << "prism_pass_gpu_time_ms{pass=\"" << escape(pass.name) << "\"} " << pass.gpuMs << "\n";
+      out << "# TYPE prism_draws gauge\nprism_draws " << lastCounters.draws << "\n";
+      out << "# TYPE prism_triangles gauge\nprism_triangles " << lastCounters.triangles << "\n";
+      out << "# TYPE prism_pipeline_binds gauge\nprism_pipeline_binds " << lastCounters.pipelineBinds << "\n";
+      out << "# TYPE prism_staging_bytes_total counter\nprism_staging_bytes_total " << totalStagingBytes << "\n";
+      out << "# TYPE prism_staging_bytes_per_second gauge\nprism_staging_bytes_per_second " << stagingBytesPerSecond() << "\n";
+      out << "# TYPE prism_heap_size_bytes gauge\n";
+      for(size_t i = 0; i < heaps.size(); i++) out << "prism_heap_size_bytes{" << heapLabels(i) << "} " << heaps[i].size << "\n";
+      if(memoryBudgetSupported)
+      {
+        out << "# TYPE prism_heap_usage_bytes gauge\n";
+        for(size_t i = 0; i < heaps.size(); i++) out << "prism_heap_usage_bytes{" << heapLabels(i) << "} " << heaps[i].usage << "\n";
+        out << "# TYPE prism_heap_budget_bytes gauge\n";
+        for(size_t i = 0; i < heaps.size(); i++) out << "prism_heap_budget_bytes{" << heapLabels(i) << "} " << heaps[i].budget << "\n";
+      }
+      return out.str();
+    }
+    std::string summary (void) // Version corta para el overlay
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      FrameTimeSummary frameTime = summarizeFrameTimes();
+      std::ostringstream out;
+      out.setf(std::ios::fixed);
+      out.precision(2);
+
+      out << frameTime.avg << "ms (" << (frameTime.avg > 0 ? 1000.0 / frameTime.avg : 0.0) << " fps)";
+      for(const auto& pass : passTimings) out << " | " << pass.name << " " << pass.gpuMs << "ms GPU";
+      out << " | " << lastCounters.draws << " draws, " << lastCounters.triangles << " tris, " << lastCounters.pipelineBinds << " binds";
+      for(const auto& heap : heaps)
+      {
+        if(heap.deviceLocal && memoryBudgetSupported)
+        {
+          out << " | VRAM " << heap.usage / (1024 * 1024) << "/" << heap.budget / (1024 * 1024) << "MB";
+          break;
+        }
+      }
+      return out.str();
+    }
+  private:
+    struct DeviceInfo { std::string name; int score; };
+    struct FrameSample { double frameMs; uint64_t stagingBytes; };
+    struct FrameTimeSummary { double last = 0, avg = 0, min = 0, max = 0; };
+    std::mutex mutex;
+    std::string selectedDevice;
+    std::vector<DeviceInfo> devices;
+    std::deque<FrameSample> history;
+    std::vector<PassTiming> passTimings;
+    std::vector<HeapInfo> heaps;
+    FrameCounters lastCounters;
+    uint64_t totalStagingBytes = 0;
+    uint64_t frameCount = 0;
+    bool memoryBudgetSupported = false;
+
+    // Todas asumen que el mutex ya esta tomado
+    FrameTimeSummary summarizeFrameTimes (void)
+    {
+      FrameTimeSummary summary;
+      if(history.empty()) return summary;
+      summary.last = history.back().frameMs;
+      summary.min = summary.max = summary.last;
+      for(const auto& sample : history)
+      {
+        summary.avg += sample.frameMs;
+        summary.min = std::min(summary.min, sample.frameMs);
+        summary.max = std::max(summary.max, sample.frameMs);
+      }
+      summary.avg /= history.size();
+      return summary;
+    }
+    double stagingBytesPerSecond (void)
+    {
+      double bytes = 0, ms = 0;
+      for(const auto& sample : history)
+      {
+        bytes += sample.stagingBytes;
+        ms += sample.frameMs;
+      }
+      return ms > 0 ? bytes * 1000.0 / ms : 0.0;
+    }
+    std::string heapLabels (size_t index)
+    {
+      return "heap=\"" + std::to_string(index) + "\",device_local=\"" + (heaps[index].deviceLocal ? "true" : "false") + "\"";
+    }
+    static std::string escape (const std::string& text)
+    {
+      std::string escaped;
+      for(char c : text)
+      {
+        if(c == '"' || c == '\\') escaped += '\\';
+        escaped += c;
+      }
+      return escaped;
+    }
+};
+
+// Servidor HTTP minimo para que el monitoreo pueda leer las estadisticas: "/" devuelve JSON y "/metrics" formato Prometheus
+class StatsServer
+{
+  public:
+    StatsServer (EngineStats& stats) : stats(stats) {}
+    ~StatsServer (void) { stop(); }
+    void start (uint16_t port)
+    {
+      listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+      if(listenSocket < 0)
+      {
+        std::cerr << "AVISO: No se pudo crear el socket de estadisticas..." << std::endl;
+        return;
+      }
+      int reuse = 1;
+      setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+      sockaddr_in address {};
+      address.sin_family = AF_INET;
+      address.sin_port = htons(port);
+      address.sin_addr.s_addr = htonl(INADDR_LOOPBACK); // Solo local, no se expone a la red
+      if(bind(listenSocket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(listenSocket, 4) < 0)
+      {
+        // No tener estadisticas no deberia impedir que el motor arranque
+        std::cerr << "AVISO: No se pudo escuchar en el puerto " << port << ", estadisticas deshabilitadas..." << std::endl;
+        close(listenSocket);
+        listenSocket = -1;
+        return;
+      }
+      running = true;
+      worker = std::thread(&StatsServer::serve, this);
+      std::cout << "Estadisticas en http://127.0.0.1:" << port << "/ (JSON) y /metrics (Prometheus)" << std::endl;
+    }
+    void stop (void)
+    {
+      running = false;
+      if(worker.joinable()) worker.join();
+      if(listenSocket >= 0) close(listenSocket);
+      listenSocket = -1;
+    }
+  private:
+    EngineStats& stats;
+    int listenSocket = -1;
+    std::atomic<bool> running = false;
+    std::thread worker;
+
+    void serve (void)
+    {
+      while(running)
+      {
+        pollfd pollInfo { listenSocket, POLLIN, 0 };
+        if(poll(&pollInfo, 1, 200) <= 0) continue; // El timeout permite revisar running periodicamente
+        int client = accept(listenSocket, nullptr, nullptr);
+        if(client < 0) continue;
+
+        timeval timeout { 1, 0 }; // Un cliente que no manda nada no puede bloquear el servidor
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        char request[1024];
+        ssize_t received = recv(client, request, sizeof(request) - 1, 0);
+        std::string path = "/";
+        if(received > 0)
+        {
+          std::istringstream requestLine(std::string(request, received));
+          std::string method;
+          requestLine >> method >> path;
+        }
+
+        std::string status = "200 OK", type, body;
+        if(path == "/metrics")
+        {
+          type = "text/plain; version=0.0.4";
+          body = stats.toPrometheus();
+        } else if(path == "/" || path == "/stats")
+        {
+          type = "application/json";
+          body = stats.toJson();
+        } else {
+          status = "404 Not Found";
+          type = "text/plain";
+          body = "Not found\n";
+        }
+        std::string response = "HTTP/1.1 " + status + "\r\nContent-Type: " + type + "\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+        send(client, response.data(), response.size(), MSG_NOSIGNAL);
+        close(client);
+      }
+    }
+};
 
 class VkApp
 {
   public: 
     void run (void)
     {
-      initWindow();
-      initVulkan();
+      initVulkan(); // La ventana se crea dentro, en paralelo con la instancia
+      statsServer.start(STATS_PORT);
       mainLoop();
       cleanup();
     }
@@ -38,6 +413,10 @@ class VkApp
     VkSurfaceKHR surface;
     VkPhysicalDevice graphicsCard;
     uint32_t currentFrame = 0;
+    StartupTrace trace;
+    bool firstPresentDone = false;
+    EngineStats stats;
+    StatsServer statsServer { stats };
 
     struct QueueFamilyIndices { std::optional<uint32_t> graphicsQueue; std::optional<uint32_t> presentQueue; };    
     struct SwapChainSupportDetails {
@@ -54,6 +433,10 @@ class VkApp
     std::vector<VkImageView> imageViews;
     VkFormat swapChainImageFormat;
     VkExtent2D swapChainExtent;
+    VkFormat depthFormat;
+    VkImage depthImage;
+    VkDeviceMemory depthImageMemory;
+    VkImageView depthImageView;
     VkRenderPass renderPass;
     VkPipelineLayout pipelineLayout;
     VkPipeline graphicsPipeline;
@@ -68,32 +451,118 @@ class VkApp
     std::vector<VkSemaphore> sRendersFinished;
     std::vector<VkFence> fFramesEnded;
 
+    //Occlusion culling
+    struct SceneObject { float boundsMin[4]; float boundsMax[4]; uint32_t firstVertex; uint32_t vertexCount; uint32_t pad[2]; }; // Mismo layout que en occlusion_cull.comp (std430)
+    struct CullParams { std::array<float, 16> viewProjection; uint32_t objectCount; uint32_t late; uint32_t counterSlot; };
+    // Mientras no haya escenas, el unico objeto es el triangulo de shader.vert (bounds en NDC, z = 0)
+    std::vector<SceneObject> sceneObjects = { { { -0.7f, -0.8f, 0.0f, 1.0f }, { 0.6f, 0.9f, 0.0f, 1.0f }, 0, 3, { 0, 0 } } };
+    std::array<float, 16> viewProjection = { 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1 }; // Identidad hasta que haya camara
+    VkRenderPass renderPassEarly = VK_NULL_HANDLE; // Limpia y deja el color listo para la fase tardia
+    VkRenderPass renderPassLate = VK_NULL_HANDLE;  // Carga color y profundidad y deja la imagen lista para presentar
+    VkImage depthPyramid = VK_NULL_HANDLE;
+    VkDeviceMemory depthPyramidMemory = VK_NULL_HANDLE;
+    VkImageView depthPyramidView = VK_NULL_HANDLE;
+    std::vector<VkImageView> depthPyramidMips;
+    VkExtent2D depthPyramidExtent;
+    uint32_t depthPyramidLevels = 0;
+    VkSampler depthPyramidSampler = VK_NULL_HANDLE;
+    VkDescriptorSetLayout pyramidSetLayout = VK_NULL_HANDLE;
+    VkDescriptorSetLayout cullSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout pyramidPipelineLayout = VK_NULL_HANDLE;
+    VkPipelineLayout cullPipelineLayout = VK_NULL_HANDLE;
+    VkPipeline pyramidPipeline = VK_NULL_HANDLE;
+    VkPipeline cullPipeline = VK_NULL_HANDLE;
+    VkDescriptorPool occlusionDescriptorPool = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> pyramidSets; // Uno por nivel de la piramide
+    VkDescriptorSet cullSet;
+    VkBuffer objectBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory objectBufferMemory = VK_NULL_HANDLE;
+    VkBuffer visibilityBuffer = VK_NULL_HANDLE; // Resultado del frame anterior, se comparte entre frames en vuelo
+    VkDeviceMemory visibilityBufferMemory = VK_NULL_HANDLE;
+    VkBuffer drawCommandBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory drawCommandBufferMemory = VK_NULL_HANDLE;
+    VkBuffer cullCounterBuffer = VK_NULL_HANDLE; // Draws y triangulos que el culling dejo pasar, un par por frame en vuelo
+    VkDeviceMemory cullCounterBufferMemory = VK_NULL_HANDLE;
+    uint32_t* cullCounters = nullptr; // Mapeado todo el tiempo
+    bool multiDrawIndirectSupported = false;
+
+    //Stats
+    VkQueryPool timestampPool = VK_NULL_HANDLE;
+    bool timestampsSupported = false;
+    float timestampPeriod = 0.0f; // Nanosegundos por tick
+    uint64_t timestampMask = 0;
+    std::vector<std::vector<std::string>> timedPasses; // Nombres de las pasadas medidas en cada frame en vuelo
+    bool memoryBudgetSupported = false;
+    EngineStats::FrameCounters frameCounters;
+    std::chrono::steady_clock::time_point lastFrameTime;
+    double lastStatsRefresh = 0.0;
+    bool overlayEnabled = false;
+
     void initWindow (void)
     {
-      glfwInit();
+      TraceScope scope(trace, __func__);
       ///// WINDOW FLAGS /////
       glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
       glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
 
-      window = glfwCreateWindow(WIDTH, HEIGHT, "prism_engine", nullptr, nullptr);
+      window = glfwCreateWindow(WIDTH, HEIGHT, WINDOW_TITLE, nullptr, nullptr);
+      glfwSetWindowUserPointer(window, this);
+      glfwSetKeyCallback(window, keyCallback);
+    }
+    static void keyCallback (GLFWwindow* window, int key, int, int action, int)
+    {
+      auto app = reinterpret_cast<VkApp*>(glfwGetWindowUserPointer(window));
+      if(key == STATS_OVERLAY_KEY && action == GLFW_PRESS) app->toggleOverlay();
     }
     void initVulkan (void)
     {
-      createVkInstance();
+      TraceScope scope(trace, __func__);
+      {
+        TraceScope glfwScope(trace, "glfwInit");
+        glfwInit();
+      }
+      // Etapa 1: la instancia y la lectura de shaders no dependen de la ventana, asi que corren en otros hilos
+      auto instanceTask = std::async(std::launch::async, [this]{ createVkInstance(); });
+      auto fragShaderTask = std::async(std::launch::async, [this]{ TraceScope s(trace, "readShader frag"); return readShader("shaders/compiled/frag.spv"); });
+      auto vertShaderTask = std::async(std::launch::async, [this]{ TraceScope s(trace, "readShader vert"); return readShader("shaders/compiled/vert.spv"); });
+      std::future<std::vector<char>> pyramidShaderTask, cullShaderTask;
+      if(OCCLUSION_CULLING)
+      {
+        pyramidShaderTask = std::async(std::launch::async, [this]{ TraceScope s(trace, "readShader depth_pyramid"); return readShader("shaders/compiled/depth_pyramid.spv"); });
+        cullShaderTask = std::async(std::launch::async, [this]{ TraceScope s(trace, "readShader occlusion_cull"); return readShader("shaders/compiled/occlusion_cull.spv"); });
+      }
+      initWindow(); // GLFW exige crear la ventana en el hilo principal
+      instanceTask.get();
+      // Etapa 2: todo esto depende de la superficie y del dispositivo, se mantiene secuencial
       createSurface();
       selectGraphicCard();  
       createLogicalDevice();
       createSwapChain();
       createImageViews();
       createRenderPass();
-      createGraphicsPipeline();
+      if(OCCLUSION_CULLING) createOcclusionDescriptorLayouts();
+      // Etapa 3: las pipelines solo necesitan el render pass y los layouts, asi que se compilan en otros hilos mientras se crea el resto
+      auto pipelineTask = std::async(std::launch::async, [&]{ createGraphicsPipeline(fragShaderTask.get(), vertShaderTask.get()); });
+      std::future<void> occlusionPipelinesTask;
+      if(OCCLUSION_CULLING) occlusionPipelinesTask = std::async(std::launch::async, [&]{ createOcclusionPipelines(pyramidShaderTask.get(), cullShaderTask.get()); });
+      createCommandPool(); // Antes que los recursos del culling, que se inicializan con comandos de un solo uso
+      createDepthResources();
+      if(OCCLUSION_CULLING)
+      {
+        createOcclusionResources();
+        createDepthPyramid();
+      }
       createFramebuffers();
-      createCommandPool();
       createCommandBuffers();
       createSyncObjects();
+      createQueryPool();
+      queryMemoryBudget(); // El endpoint arranca despues de initVulkan: que ya tenga los heaps
+      pipelineTask.get();
+      if(OCCLUSION_CULLING) occlusionPipelinesTask.get();
     }
     void mainLoop (void)
     {
+      lastFrameTime = std::chrono::steady_clock::now();
       while(!glfwWindowShouldClose(window))
       {
         glfwPollEvents();
@@ -103,6 +572,7 @@ class VkApp
     }
     void cleanup (void)
     {
+      statsServer.stop();
       ///// CLEAN SYNC /////
       for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
       {
@@ -111,7 +581,29 @@ class VkApp
         vkDestroyFence(device, fFramesEnded[i], nullptr);
       }
       ///// CLEAN VULKAN /////
+      vkDestroyQueryPool(device, timestampPool, nullptr);
       cleanupSwapchain();
+      if(OCCLUSION_CULLING)
+      {
+        vkDestroyPipeline(device, pyramidPipeline, nullptr);
+        vkDestroyPipeline(device, cullPipeline, nullptr);
+        vkDestroyPipelineLayout(device, pyramidPipelineLayout, nullptr);
+        vkDestroyPipelineLayout(device, cullPipelineLayout, nullptr);
+        vkDestroyDescriptorSetLayout(device, pyramidSetLayout, nullptr);
+        vkDestroyDescriptorSetLayout(device, cullSetLayout, nullptr);
+        vkDestroySampler(device, depthPyramidSampler, nullptr);
+        vkDestroyBuffer(device, objectBuffer, nullptr);
+        vkFreeMemory(device, objectBufferMemory, nullptr);
+        vkDestroyBuffer(device, visibilityBuffer, nullptr);
+        vkFreeMemory(device, visibilityBufferMemory, nullptr);
+        vkDestroyBuffer(device, drawCommandBuffer, nullptr);
+        vkFreeMemory(device, drawCommandBufferMemory, nullptr);
+        vkUnmapMemory(device, cullCounterBufferMemory);
+        vkDestroyBuffer(device, cullCounterBuffer, nullptr);
+        vkFreeMemory(device, cullCounterBufferMemory, nullptr);
+        vkDestroyRenderPass(device, renderPassEarly, nullptr);
+        vkDestroyRenderPass(device, renderPassLate, nullptr);
+      }
       vkDestroyCommandPool(device, commandPool, nullptr);
       vkDestroyPipeline(device, graphicsPipeline, nullptr);
       vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
@@ -127,11 +619,14 @@ class VkApp
     {
       vkWaitForFences(device, 1, &fFramesEnded[currentFrame], VK_TRUE, UINT64_MAX);
       vkResetFences(device, 1, &fFramesEnded[currentFrame]);
+      collectPassTimings(currentFrame); // El fence asegura que los timestamps de este frame ya estan escritos
     
       uint32_t imageIndex;
       VkResult result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, sImagesAvailable[currentFrame], VK_NULL_HANDLE, &imageIndex);
 
       vkResetCommandBuffer(commandBuffers[currentFrame], 0);
+      frameCounters = {};
+      if(OCCLUSION_CULLING) collectCullCounters(currentFrame); // El fence asegura que el culling de este slot ya termino
       recordCommandBuffer(commandBuffers[currentFrame], imageIndex); 
       VkSemaphore waitSemaphores[] = { sImagesAvailable[currentFrame] };
       VkSemaphore signalSemaphores[] = { sRendersFinished[currentFrame] };
@@ -157,6 +652,15 @@ class VkApp
       presentInfo.pImageIndices = &imageIndex;
       vkQueuePresentKHR(presentQueue, &presentInfo);
 
+      if(!firstPresentDone)
+      {
+        trace.record("startup", processStart, std::chrono::steady_clock::now());
+        trace.instant("firstPresent");
+        trace.write(STARTUP_TRACE_FILE);
+        firstPresentDone = true;
+      }
+      updateStats();
+
       if(result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
       {
         recreateSwapchain();
@@ -169,22 +673,30 @@ class VkApp
     }
     void createSurface (void)
     {
+      TraceScope scope(trace, __func__);
       if(glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS) throw std::runtime_error("ERROR: No se pudo crear la superficie de la ventana...");
     }
     void createVkInstance (void)
     {
+      TraceScope scope(trace, __func__);
       uint32_t extensionCount = 0;
       const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&extensionCount);
 
       VkInstanceCreateInfo createInfo {};
       createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-    //createInfo.pApplicationInfo = &appinfo;                 ////No aplica porque no cree un VkApplicationInfo (opcional)
+      VkApplicationInfo appInfo {};
+      appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+      appInfo.pApplicationName = WINDOW_TITLE;
+      appInfo.pEngineName = "Prism Engine";
+      appInfo.apiVersion = VK_API_VERSION_1_1; // Necesario para vkGetPhysicalDeviceMemoryProperties2 (VK_EXT_memory_budget)
+      createInfo.pApplicationInfo = &appInfo;
       createInfo.enabledExtensionCount = extensionCount;
       createInfo.ppEnabledExtensionNames = glfwExtensions;
       if(vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS) throw std::runtime_error("ERROR: No se pudo generar la instancia de Vulkan..."); 
     }
     void selectGraphicCard (void)
     {
+      TraceScope scope(trace, __func__);
       uint32_t graphicsCount = 0;
       vkEnumeratePhysicalDevices(instance, &graphicsCount, nullptr);
       
@@ -195,19 +707,27 @@ class VkApp
       filterBestSuitablePhysicalDevice(graphicsList);
       findQueueFamilies(graphicsCard);
     }
-    bool physicalDeviceSupportsExtensions (VkPhysicalDevice device)
+    std::vector<VkExtensionProperties> availableDeviceExtensions (VkPhysicalDevice device)
     {
       uint32_t extensionCount; 
 
       vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
       std::vector<VkExtensionProperties> availableExtensions(extensionCount);
       vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
-
+      return availableExtensions;
+    }
+    bool physicalDeviceSupportsExtensions (VkPhysicalDevice device)
+    {
       std::set<std::string> allExtensions(requiredExtensions.begin(), requiredExtensions.end());
-      for(const auto& extension : availableExtensions) allExtensions.erase(extension.extensionName);
+      for(const auto& extension : availableDeviceExtensions(device)) allExtensions.erase(extension.extensionName);
       
       return allExtensions.empty() ? true : false;
     }
+    bool physicalDeviceSupportsExtension (VkPhysicalDevice device, const std::string& name)
+    {
+      for(const auto& extension : availableDeviceExtensions(device)) if(name == extension.extensionName) return true;
+      return false;
+    }
     void filterBestSuitablePhysicalDevice (std::vector<VkPhysicalDevice> devices)
     {
       std::multimap<int, VkPhysicalDevice> orderedDevices;
@@ -232,12 +752,15 @@ class VkApp
         }
         orderedDevices.insert(std::make_pair(score, device));
         std::cout << "DEVICE DETECTED: " << properties.deviceName << " \t SCORE: " << score << "pt" << std::endl;
+        stats.addDevice(properties.deviceName, score);
         score = 0;
       }
     // Si la mayor puntuacion es menor a 0, todas fueron descalificadas
       if(orderedDevices.rbegin()->first < 0) throw std::runtime_error("ERROR: Ninguna grafica cumple con los requisitos...");
     // Asignar grafica con mayor puntaje (inicio del mapa ordenado)
       graphicsCard = orderedDevices.rbegin()->second;
+      vkGetPhysicalDeviceProperties(graphicsCard, &properties);
+      stats.setSelectedDevice(properties.deviceName);
     }
     void findQueueFamilies (VkPhysicalDevice device)
     { //TODO: Ver si borro queueFamilies de la clase, y hago que esta funcion returnee VkQueueFamilyProperties
@@ -271,7 +794,13 @@ class VkApp
     }
     void createLogicalDevice (void)
     {
-      VkPhysicalDeviceFeatures deviceFeatures {}; //No pedi ninguna feature antes, asi que aca no hago nada
+      TraceScope scope(trace, __func__);
+      VkPhysicalDeviceFeatures supportedFeatures;
+      vkGetPhysicalDeviceFeatures(graphicsCard, &supportedFeatures);
+      VkPhysicalDeviceFeatures deviceFeatures {};
+      // Opcional: sin multiDrawIndirect el culling emite un vkCmdDrawIndirect por objeto
+      multiDrawIndirectSupported = supportedFeatures.multiDrawIndirect == VK_TRUE;
+      deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
       std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
       std::set<uint32_t> uniqueQueueFamilies = {queueIndices.presentQueue.value(),queueIndices.graphicsQueue.value()};
       float queuePriority = 1.0f;
@@ -286,13 +815,20 @@ class VkApp
         queueCreateInfos.push_back(queueCreateInfo);
       }
 
+      // VK_EXT_memory_budget es opcional: si no esta, las estadisticas solo muestran el tamaño de cada heap
+      std::vector<const char*> deviceExtensions(requiredExtensions.begin(), requiredExtensions.end());
+      VkPhysicalDeviceProperties properties;
+      vkGetPhysicalDeviceProperties(graphicsCard, &properties);
+      memoryBudgetSupported = properties.apiVersion >= VK_API_VERSION_1_1 && physicalDeviceSupportsExtension(graphicsCard, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+      if(memoryBudgetSupported) deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
       VkDeviceCreateInfo createInfo {};
       createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO; 
       createInfo.pQueueCreateInfos = queueCreateInfos.data();
       createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
       createInfo.pEnabledFeatures = &deviceFeatures; 
-      createInfo.enabledExtensionCount = static_cast<uint32_t>(requiredExtensions.size()); 
-      createInfo.ppEnabledExtensionNames = requiredExtensions.data(); 
+      createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size()); 
+      createInfo.ppEnabledExtensionNames = deviceExtensions.data(); 
       if(vkCreateDevice(graphicsCard, &createInfo, nullptr, &device) != VK_SUCCESS) throw std::runtime_error("ERROR: No se pudo crear un dispositivo logico...");
 
       vkGetDeviceQueue(device, queueIndices.graphicsQueue.value(), 0, &graphicsQueue);
@@ -349,6 +885,7 @@ class VkApp
     }
     void createSwapChain (void)
     {
+      TraceScope scope(trace, __func__);
       SwapChainSupportDetails details = querySwapChainSupport(graphicsCard);
       VkSurfaceFormatKHR format = chooseSurfaceFormat(details.formats);
       VkPresentModeKHR presentMode = choosePresentMode(details.presentModes);
@@ -394,6 +931,7 @@ class VkApp
     }
     void createImageViews (void)
     {
+      TraceScope scope(trace, __func__);
       imageViews.resize(swapChainImages.size());
 
       for(int i = 0; i < swapChainImages.size(); i++)
@@ -416,10 +954,9 @@ class VkApp
         if(vkCreateImageView(device, &createInfo, nullptr, &imageViews[i]) != VK_SUCCESS) throw std::runtime_error("ERROR: No pudieron generarse las imagenes de la swapchain...");
       }
     }
-    void createGraphicsPipeline (void)
+    void createGraphicsPipeline (const std::vector<char>& fragShader, const std::vector<char>& vertShader)
     {
-      auto fragShader = readShader("shaders/compiled/frag.spv"); 
-      auto vertShader = readShader("shaders/compiled/vert.spv"); 
+      TraceScope scope(trace, __func__);
       VkShaderModule fragShaderModule = createShaderModule(fragShader);
       VkShaderModule vertShaderModule = createShaderModule(vertShader);
 
@@ -503,6 +1040,14 @@ class VkApp
       colorBlend.attachmentCount = 1;
       colorBlend.pAttachments = &colorBlendAttachment;
 
+      VkPipelineDepthStencilStateCreateInfo depthStencil {};
+      depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+      depthStencil.depthTestEnable = VK_TRUE;
+      depthStencil.depthWriteEnable = VK_TRUE;
+      depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+      depthStencil.depthBoundsTestEnable = VK_FALSE;
+      depthStencil.stencilTestEnable = VK_FALSE;
+
       VkPipelineLayoutCreateInfo pipelineLayoutInfo {};
       pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
       
@@ -517,7 +1062,7 @@ class VkApp
       pipelineInfo.pViewportState = &viewportState;
       pipelineInfo.pRasterizationState = &rasterizer;
       pipelineInfo.pMultisampleState = &multisample;
-      pipelineInfo.pDepthStencilState = nullptr;
+      pipelineInfo.pDepthStencilState = &depthStencil;
       pipelineInfo.pColorBlendState = &colorBlend;
       pipelineInfo.pDynamicState = &dynamicState;
       pipelineInfo.layout = pipelineLayout;
@@ -531,46 +1076,91 @@ class VkApp
       vkDestroyShaderModule(device, vertShaderModule, nullptr);
     }
     void createRenderPass (void)
+    {
+      TraceScope scope(trace, __func__);
+      depthFormat = findDepthFormat();
+      renderPass = buildRenderPass(VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+      if(OCCLUSION_CULLING)
+      {
+        // Son compatibles con renderPass (mismos attachments), asi que comparten framebuffers y pipeline.
+        // Solo la profundidad de la fase temprana se lee despues (la piramide se arma con ella)
+        renderPassEarly = buildRenderPass(VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+        renderPassLate = buildRenderPass(VK_ATTACHMENT_LOAD_OP_LOAD, VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+      }
+    }
+    VkRenderPass buildRenderPass (VkAttachmentLoadOp loadOp, VkAttachmentStoreOp depthStoreOp, VkImageLayout colorInitialLayout, VkImageLayout colorFinalLayout)
     {
       VkAttachmentDescription colorAttachment {};
       colorAttachment.format = swapChainImageFormat;
       colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT; // Tiene que ver con MSAA
-      colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+      colorAttachment.loadOp = loadOp;
       colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
       colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
       colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-      colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-      colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+      colorAttachment.initialLayout = colorInitialLayout;
+      colorAttachment.finalLayout = colorFinalLayout;
+
+      VkAttachmentDescription depthAttachment {};
+      depthAttachment.format = depthFormat;
+      depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+      depthAttachment.loadOp = loadOp;
+      depthAttachment.storeOp = depthStoreOp;
+      depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+      depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+      depthAttachment.initialLayout = loadOp == VK_ATTACHMENT_LOAD_OP_LOAD ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+      depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
       
       VkAttachmentReference colorAttachmentRef {};
       colorAttachmentRef.attachment = 0;
       colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+      VkAttachmentReference depthAttachmentRef {};
+      depthAttachmentRef.attachment = 1;
+      depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
       VkSubpassDescription subpass {};
       subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
       subpass.colorAttachmentCount = 1;
       subpass.pColorAttachments = &colorAttachmentRef;
+      subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+      // El depth buffer es uno solo, asi que el frame siguiente (o la fase tardia) espera a que se termine de escribir
+      VkSubpassDependency dependency {};
+      dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+      dependency.dstSubpass = 0;
+      dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+      dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+      dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+      dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+      // La fase tardia carga el color de la temprana: esa lectura tambien tiene que esperar a la escritura
+      if(loadOp == VK_ATTACHMENT_LOAD_OP_LOAD) dependency.dstAccessMask |= VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
 
+      VkAttachmentDescription attachments[] = { colorAttachment, depthAttachment };
       VkRenderPassCreateInfo createInfo {};
       createInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-      createInfo.attachmentCount = 1;
-      createInfo.pAttachments = &colorAttachment;
+      createInfo.attachmentCount = 2;
+      createInfo.pAttachments = attachments;
       createInfo.subpassCount = 1;
       createInfo.pSubpasses = &subpass;
+      createInfo.dependencyCount = 1;
+      createInfo.pDependencies = &dependency;
 
-      if(vkCreateRenderPass(device, &createInfo, nullptr, &renderPass) != VK_SUCCESS) throw std::runtime_error("ERROR: No se pudo crear el Render Pass...");
+      VkRenderPass newRenderPass;
+      if(vkCreateRenderPass(device, &createInfo, nullptr, &newRenderPass) != VK_SUCCESS) throw std::runtime_error("ERROR: No se pudo crear el Render Pass...");
+      return newRenderPass;
     }
     void createFramebuffers (void)
     {
+      TraceScope scope(trace, __func__);
       swapChainFramebuffers.resize(imageViews.size());
       for(int i = 0; i < imageViews.size(); i++)
       {
-        VkImageView attachments[] = { imageViews[i] };
+        VkImageView attachments[] = { imageViews[i], depthImageView };
 
         VkFramebufferCreateInfo createInfo {};
         createInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
         createInfo.renderPass = renderPass;
-        createInfo.attachmentCount = 1;
+        createInfo.attachmentCount = 2;
         createInfo.pAttachments = attachments;
         createInfo.width = swapChainExtent.width;
         createInfo.height = swapChainExtent.height;
@@ -579,16 +1169,336 @@ class VkApp
         if(vkCreateFramebuffer(device, &createInfo, nullptr, &swapChainFramebuffers[i]) != VK_SUCCESS) throw std::runtime_error("ERROR: No se pudieron crear los Frambuffers...");
       }
     }
+    VkFormat findDepthFormat (void)
+    {
+      // Con occlusion culling la profundidad tambien se lee desde el compute shader de la piramide
+      VkFormatFeatureFlags required = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | (OCCLUSION_CULLING ? VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT : 0);
+      for(VkFormat format : { VK_FORMAT_D32_SFLOAT, VK_FORMAT_X8_D24_UNORM_PACK32 })
+      {
+        VkFormatProperties properties;
+        vkGetPhysicalDeviceFormatProperties(graphicsCard, format, &properties);
+        if((properties.optimalTilingFeatures & required) == required) return format;
+      }
+      throw std::runtime_error("ERROR: La grafica no soporta ningun formato de profundidad...");
+    }
+    void createDepthResources (void)
+    {
+      TraceScope scope(trace, __func__);
+      VkImageUsageFlags usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | (OCCLUSION_CULLING ? VK_IMAGE_USAGE_SAMPLED_BIT : 0);
+      createImage(swapChainExtent.width, swapChainExtent.height, 1, depthFormat, usage, depthImage, depthImageMemory);
+      depthImageView = createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1);
+    }
+    void createOcclusionDescriptorLayouts (void)
+    {
+      TraceScope scope(trace, __func__);
+      // Piramide: nivel anterior (o el depth buffer) -> nivel actual
+      VkDescriptorSetLayoutBinding pyramidBindings[2] {};
+      pyramidBindings[0].binding = 0;
+      pyramidBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+      pyramidBindings[0].descriptorCount = 1;
+      pyramidBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+      pyramidBindings[1].binding = 1;
+      pyramidBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+      pyramidBindings[1].descriptorCount = 1;
+      pyramidBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+      // Culling: objetos, visibilidad, draws indirectos, la piramide completa y los contadores
+      VkDescriptorSetLayoutBinding cullBindings[5] {};
+      for(uint32_t i = 0; i < 5; i++)
+      {
+        cullBindings[i].binding = i;
+        cullBindings[i].descriptorType = i == 3 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        cullBindings[i].descriptorCount = 1;
+        cullBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+      }
+
+      VkDescriptorSetLayoutCreateInfo createInfo {};
+      createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+      createInfo.bindingCount = 2;
+      createInfo.pBindings = pyramidBindings;
+      if(vkCreateDescriptorSetLayout(device, &createInfo, nullptr, &pyramidSetLayout) != VK_SUCCESS) throw std::runtime_error("ERROR: No se pudo crear el descriptor set layout de la piramide de profundidad...");
+      createInfo.bindingCount = 5;
+      createInfo.pBindings = cullBindings;
+      if(vkCreateDescriptorSetLayout(device, &createInfo, nullptr, &cullSetLayout) != VK_SUCCESS) throw std::runtime_error("ERROR: No se pudo crear el descriptor set layout del culling...");
+    }
+    void createOcclusionPipelines (const std::vector<char>& pyramidShader, const std::vector<char>& cullShader)
+    {
+      TraceScope scope(trace, __func__);
+      VkPipelineLayoutCreateInfo layoutInfo {};
+      layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+      layoutInfo.setLayoutCount = 1;
+      layoutInfo.pSetLayouts = &pyramidSetLayout;
+      if(vkCreatePipelineLayout(device, &layoutInfo, nullptr, &pyramidPipelineLayout) != VK_SUCCESS) throw std::runtime_error("ERROR: No se pudo crear el pipeline layout de la piramide de profundidad...");
+
+      VkPushConstantRange pushConstants {};
+      pushConstants.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+      pushConstants.offset = 0;
+      pushConstants.size = sizeof(CullParams);
+      layoutInfo.pSetLayouts = &cullSetLayout;
+      layoutInfo.pushConstantRangeCount = 1;
+      layoutInfo.pPushConstantRanges = &pushConstants;
+      if(vkCreatePipelineLayout(device, &layoutInfo, nullptr, &cullPipelineLayout) != VK_SUCCESS) throw std::runtime_error("ERROR: No se pudo crear el pipeline layout del culling...");
+
+      pyramidPipeline = createComputePipeline(pyramidShader, pyramidPipelineLayout);
+      cullPipeline = createComputePipeline(cullShader, cullPipelineLayout);
+    }
+    VkPipeline createComputePipeline (const std::vector<char>& shader, VkPipelineLayout layout)
+    {
+      VkShaderModule shaderModule = createShaderModule(shader);
+
+      VkComputePipelineCreateInfo pipelineInfo {};
+      pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+      pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+      pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+      pipelineInfo.stage.module = shaderModule;
+      pipelineInfo.stage.pName = "main";
+      pipelineInfo.layout = layout;
+
+      VkPipeline pipeline;
+      if(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) throw std::runtime_error("ERROR: No se pudo crear una pipeline de compute...");
+      vkDestroyShaderModule(device, shaderModule, nullptr);
+      return pipeline;
+    }
+    void createOcclusionResources (void)
+    {
+      TraceScope scope(trace, __func__);
+      VkDeviceSize objectsSize = sizeof(SceneObject) * sceneObjects.size();
+      createBuffer(objectsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, objectBuffer, objectBufferMemory);
+      void* data;
+      vkMapMemory(device, objectBufferMemory, 0, objectsSize, 0, &data);
+      std::memcpy(data, sceneObjects.data(), objectsSize);
+      vkUnmapMemory(device, objectBufferMemory);
+
+      createBuffer(sizeof(uint32_t) * sceneObjects.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, visibilityBuffer, visibilityBufferMemory);
+      VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+      vkCmdFillBuffer(commandBuffer, visibilityBuffer, 0, VK_WHOLE_SIZE, 0); // Al arrancar nada era visible
+      endSingleTimeCommands(commandBuffer);
+      // Dos tandas de draws: [0, n) fase temprana, [n, 2n) fase tardia
+      createBuffer(sizeof(VkDrawIndirectCommand) * sceneObjects.size() * 2, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, drawCommandBuffer, drawCommandBufferMemory);
+      // El CPU no sabe cuantos draws sobreviven al culling: el shader los cuenta y se leen cuando termina el frame
+      VkDeviceSize countersSize = sizeof(uint32_t) * 2 * MAX_FRAMES_IN_FLIGHT;
+      createBuffer(countersSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, cullCounterBuffer, cullCounterBufferMemory);
+      vkMapMemory(device, cullCounterBufferMemory, 0, countersSize, 0, &data);
+      cullCounters = static_cast<uint32_t*>(data);
+      std::memset(cullCounters, 0, countersSize);
+
+      VkSamplerCreateInfo samplerInfo {};
+      samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+      samplerInfo.magFilter = VK_FILTER_NEAREST; // Los shaders usan texelFetch, no se filtra nunca
+      samplerInfo.minFilter = VK_FILTER_NEAREST;
+      samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+      samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+      samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+      samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+      samplerInfo.minLod = 0.0f;
+      samplerInfo.maxLod = 16.0f;
+      if(vkCreateSampler(device, &samplerInfo, nullptr, &depthPyramidSampler) != VK_SUCCESS) throw std::runtime_error("ERROR: No se pudo crear el sampler de la piramide de profundidad...");
+    }
+    void createDepthPyramid (void)
+    {
+      TraceScope scope(trace, __func__);
+      // Potencia de 2 menor o igual a la pantalla, asi cada nivel es exactamente la mitad del anterior
+      auto previousPow2 = [](uint32_t value){ uint32_t result = 1; while(result * 2 <= value) result *= 2; return result; };
+      depthPyramidExtent = { previousPow2(swapChainExtent.width), previousPow2(swapChainExtent.height) };
+      depthPyramidLevels = static_cast<uint32_t>(std::log2(std::max(depthPyramidExtent.width, depthPyramidExtent.height))) + 1;
+
+      createImage(depthPyramidExtent.width, depthPyramidExtent.height, depthPyramidLevels, VK_FORMAT_R32_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, depthPyramid, depthPyramidMemory);
+      depthPyramidView = createImageView(depthPyramid, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, 0, depthPyramidLevels);
+      depthPyramidMips.resize(depthPyramidLevels);
+      for(uint32_t level = 0; level < depthPyramidLevels; level++) depthPyramidMips[level] = createImageView(depthPyramid, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, level, 1);
+
+      // La piramide vive en GENERAL: el culling temprano la lee antes de que se construya en el frame
+      VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+      VkImageMemoryBarrier toGeneral = imageBarrier(depthPyramid, VK_IMAGE_ASPECT_COLOR_BIT, 0, depthPyramidLevels,
+                                                    VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 0, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+      vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &toGeneral);
+      endSingleTimeCommands(commandBuffer);
+
+      VkDescriptorPoolSize poolSizes[3] {};
+      poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+      poolSizes[0].descriptorCount = depthPyramidLevels + 1;
+      poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+      poolSizes[1].descriptorCount = depthPyramidLevels;
+      poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      poolSizes[2].descriptorCount = 4;
+
+      VkDescriptorPoolCreateInfo poolInfo {};
+      poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+      poolInfo.maxSets = depthPyramidLevels + 1;
+      poolInfo.poolSizeCount = 3;
+      poolInfo.pPoolSizes = poolSizes;
+      if(vkCreateDescriptorPool(device, &poolInfo, nullptr, &occlusionDescriptorPool) != VK_SUCCESS) throw std::runtime_error("ERROR: No se pudo crear el descriptor pool del occlusion culling...");
+
+      std::vector<VkDescriptorSetLayout> layouts(depthPyramidLevels, pyramidSetLayout);
+      layouts.push_back(cullSetLayout);
+      std::vector<VkDescriptorSet> sets(layouts.size());
+      VkDescriptorSetAllocateInfo allocInfo {};
+      allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+      allocInfo.descriptorPool = occlusionDescriptorPool;
+      allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+      allocInfo.pSetLayouts = layouts.data();
+      if(vkAllocateDescriptorSets(device, &allocInfo, sets.data()) != VK_SUCCESS) throw std::runtime_error("ERROR: No se pudieron alocar los descriptor sets del occlusion culling...");
+      pyramidSets.assign(sets.begin(), sets.end() - 1);
+      cullSet = sets.back();
+
+      for(uint32_t level = 0; level < depthPyramidLevels; level++)
+      {
+        VkDescriptorImageInfo input {};
+        input.sampler = depthPyramidSampler;
+        input.imageView = level == 0 ? depthImageView : depthPyramidMips[level - 1];
+        input.imageLayout = level == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+        VkDescriptorImageInfo output {};
+        output.imageView = depthPyramidMips[level];
+        output.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        VkWriteDescriptorSet writes[2] {};
+        writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[0].dstSet = pyramidSets[level];
+        writes[0].dstBinding = 0;
+        writes[0].descriptorCount = 1;
+        writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writes[0].pImageInfo = &input;
+        writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[1].dstSet = pyramidSets[level];
+        writes[1].dstBinding = 1;
+        writes[1].descriptorCount = 1;
+        writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        writes[1].pImageInfo = &output;
+        vkUpdateDescriptorSets(device, 2, writes, 0, nullptr);
+      }
+
+      VkDescriptorBufferInfo buffers[5] {};
+      buffers[0] = { objectBuffer, 0, VK_WHOLE_SIZE };
+      buffers[1] = { visibilityBuffer, 0, VK_WHOLE_SIZE };
+      buffers[2] = { drawCommandBuffer, 0, VK_WHOLE_SIZE };
+      buffers[4] = { cullCounterBuffer, 0, VK_WHOLE_SIZE };
+      VkDescriptorImageInfo pyramid {};
+      pyramid.sampler = depthPyramidSampler;
+      pyramid.imageView = depthPyramidView;
+      pyramid.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+      VkWriteDescriptorSet writes[5] {};
+      for(uint32_t i = 0; i < 5; i++)
+      {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = cullSet;
+        writes[i].dstBinding = i;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = i == 3 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        if(i == 3) writes[i].pImageInfo = &pyramid;
+        else writes[i].pBufferInfo = &buffers[i];
+      }
+      vkUpdateDescriptorSets(device, 5, writes, 0, nullptr);
+    }
+    void createImage (uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageUsageFlags usage, VkImage& image, VkDeviceMemory& memory)
+    {
+      VkImageCreateInfo createInfo {};
+      createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+      createInfo.imageType = VK_IMAGE_TYPE_2D;
+      createInfo.format = format;
+      createInfo.extent = { width, height, 1 };
+      createInfo.mipLevels = mipLevels;
+      createInfo.arrayLayers = 1;
+      createInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+      createInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+      createInfo.usage = usage;
+      createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+      createInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+      if(vkCreateImage(device, &createInfo, nullptr, &image) != VK_SUCCESS) throw std::runtime_error("ERROR: No se pudo crear una imagen...");
+
+      VkMemoryRequirements requirements;
+      vkGetImageMemoryRequirements(device, image, &requirements);
+      VkMemoryAllocateInfo allocInfo {};
+      allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+      allocInfo.allocationSize = requirements.size;
+      allocInfo.memoryTypeIndex = findMemoryType(requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+      if(vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS) throw std::runtime_error("ERROR: No se pudo alocar memoria para una imagen...");
+      vkBindImageMemory(device, image, memory, 0);
+    }
+    VkImageView createImageView (VkImage image, VkFormat format, VkImageAspectFlags aspect, uint32_t baseMipLevel, uint32_t levelCount)
+    {
+      VkImageViewCreateInfo createInfo {};
+      createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+      createInfo.image = image;
+      createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+      createInfo.format = format;
+      createInfo.subresourceRange.aspectMask = aspect;
+      createInfo.subresourceRange.baseMipLevel = baseMipLevel;
+      createInfo.subresourceRange.levelCount = levelCount;
+      createInfo.subresourceRange.baseArrayLayer = 0;
+      createInfo.subresourceRange.layerCount = 1;
+
+      VkImageView imageView;
+      if(vkCreateImageView(device, &createInfo, nullptr, &imageView) != VK_SUCCESS) throw std::runtime_error("ERROR: No se pudo crear un image view...");
+      return imageView;
+    }
+    void createBuffer (VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& memory)
+    {
+      VkBufferCreateInfo createInfo {};
+      createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+      createInfo.size = size;
+      createInfo.usage = usage;
+      createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+      if(vkCreateBuffer(device, &createInfo, nullptr, &buffer) != VK_SUCCESS) throw std::runtime_error("ERROR: No se pudo crear un buffer...");
+
+      VkMemoryRequirements requirements;
+      vkGetBufferMemoryRequirements(device, buffer, &requirements);
+      VkMemoryAllocateInfo allocInfo {};
+      allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+      allocInfo.allocationSize = requirements.size;
+      allocInfo.memoryTypeIndex = findMemoryType(requirements.memoryTypeBits, properties);
+      if(vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS) throw std::runtime_error("ERROR: No se pudo alocar memoria para un buffer...");
+      vkBindBufferMemory(device, buffer, memory, 0);
+    }
+    uint32_t findMemoryType (uint32_t typeFilter, VkMemoryPropertyFlags properties)
+    {
+      VkPhysicalDeviceMemoryProperties memoryProperties;
+      vkGetPhysicalDeviceMemoryProperties(graphicsCard, &memoryProperties);
+      for(uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+      {
+        if((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) return i;
+      }
+      throw std::runtime_error("ERROR: No se encontro un tipo de memoria adecuado...");
+    }
     void createCommandPool (void)
     {
+      TraceScope scope(trace, __func__);
       VkCommandPoolCreateInfo createInfo{};
       createInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
       createInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
       createInfo.queueFamilyIndex = queueIndices.graphicsQueue.value();
       if(vkCreateCommandPool(device, &createInfo, nullptr, &commandPool) != VK_SUCCESS) throw std::runtime_error("ERROR: No se pudo crear la Command pool...");
     }
+    VkCommandBuffer beginSingleTimeCommands (void)
+    {
+      VkCommandBufferAllocateInfo allocInfo {};
+      allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+      allocInfo.commandPool = commandPool;
+      allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+      allocInfo.commandBufferCount = 1;
+      VkCommandBuffer commandBuffer;
+      if(vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) throw std::runtime_error("ERROR: No se pudo alocar un command buffer de un solo uso...");
+
+      VkCommandBufferBeginInfo beginInfo {};
+      beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+      beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+      if(vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) throw std::runtime_error("ERROR: No se pudo empezar un command buffer de un solo uso...");
+      return commandBuffer;
+    }
+    void endSingleTimeCommands (VkCommandBuffer commandBuffer)
+    {
+      if(vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) throw std::runtime_error("ERROR: No se pudo terminar un command buffer de un solo uso...");
+      VkSubmitInfo submitInfo {};
+      submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+      submitInfo.commandBufferCount = 1;
+      submitInfo.pCommandBuffers = &commandBuffer;
+      if(vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) throw std::runtime_error("ERROR: No se pudo enviar un command buffer de un solo uso...");
+      vkQueueWaitIdle(graphicsQueue); // Solo se usa al crear recursos, no vale la pena sincronizar con fences
+      vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+    }
     void createCommandBuffers (void)
     {
+      TraceScope scope(trace, __func__);
       commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
       VkCommandBufferAllocateInfo createInfo {};
       createInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -599,25 +1509,12 @@ class VkApp
     }
     void recordCommandBuffer (VkCommandBuffer commandBuffer, uint32_t& imageIndex)
     {
-      VkClearValue clearColor = BACKGROUND; //asumo
-
       VkCommandBufferBeginInfo beginInfo {};
       beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
       beginInfo.flags = 0; // Buscar info al respecto
       beginInfo.pInheritanceInfo = nullptr; // Buscar info al respecto
       if(vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) throw std::runtime_error("ERROR: No se pudo comenzar a escribir el command buffer...");
-
-      VkRenderPassBeginInfo renderBeginInfo {};
-      renderBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-      renderBeginInfo.renderPass = renderPass;
-      renderBeginInfo.framebuffer = swapChainFramebuffers[imageIndex];
-      renderBeginInfo.renderArea.offset = {0, 0};
-      renderBeginInfo.renderArea.extent = swapChainExtent;
-      renderBeginInfo.clearValueCount = 1;
-      renderBeginInfo.pClearValues = &clearColor;
-      //Commands
-      vkCmdBeginRenderPass(commandBuffer, &renderBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-      vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+      resetPassTimings(commandBuffer);
 
       VkViewport viewport {};
       viewport.x = 0.0f;
@@ -633,13 +1530,143 @@ class VkApp
       scissor.extent = swapChainExtent;
       vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-      vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+      //Commands
+      if(OCCLUSION_CULLING)
+      {
+        recordOcclusionCulledPasses(commandBuffer, imageIndex);
+      } else {
+        beginPassTiming(commandBuffer, "main");
+        beginScenePass(commandBuffer, renderPass, imageIndex);
+        cmdDraw(commandBuffer, 3, 1, 0, 0);
+        vkCmdEndRenderPass(commandBuffer);
+        endPassTiming(commandBuffer);
+      }
+      if(vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) throw std::runtime_error("ERROR: No se pudo terminar de escribir el command buffer...");
+    }
+    void beginScenePass (VkCommandBuffer commandBuffer, VkRenderPass pass, uint32_t imageIndex)
+    {
+      VkClearValue clearValues[2] = { BACKGROUND }; //asumo
+      clearValues[1].depthStencil = { 1.0f, 0 };
 
+      VkRenderPassBeginInfo renderBeginInfo {};
+      renderBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+      renderBeginInfo.renderPass = pass;
+      renderBeginInfo.framebuffer = swapChainFramebuffers[imageIndex];
+      renderBeginInfo.renderArea.offset = {0, 0};
+      renderBeginInfo.renderArea.extent = swapChainExtent;
+      renderBeginInfo.clearValueCount = 2;
+      renderBeginInfo.pClearValues = clearValues;
+      vkCmdBeginRenderPass(commandBuffer, &renderBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+      cmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+    }
+    // Fase temprana: dibuja lo visible el frame anterior. Con esa profundidad se arma la piramide,
+    // se testea el resto de los objetos y la fase tardia dibuja solo lo que recien aparece
+    void recordOcclusionCulledPasses (VkCommandBuffer commandBuffer, uint32_t imageIndex)
+    {
+      uint32_t objectCount = static_cast<uint32_t>(sceneObjects.size());
+      vkCmdFillBuffer(commandBuffer, cullCounterBuffer, currentFrame * 2 * sizeof(uint32_t), 2 * sizeof(uint32_t), 0);
+      // Los buffers se comparten entre frames en vuelo: el frame anterior tiene que terminar de usarlos
+      cmdMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+      beginPassTiming(commandBuffer, "cullEarly");
+      dispatchCull(commandBuffer, false);
+      endPassTiming(commandBuffer);
+      cmdMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+
+      beginPassTiming(commandBuffer, "drawEarly");
+      beginScenePass(commandBuffer, renderPassEarly, imageIndex);
+      cmdDrawIndirect(commandBuffer, drawCommandBuffer, 0, objectCount);
       vkCmdEndRenderPass(commandBuffer);
-      if(vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) throw std::runtime_error("ERROR: No se pudo terminar de escribir el command buffer...");
+      endPassTiming(commandBuffer);
+
+      VkImageMemoryBarrier depthToRead = imageBarrier(depthImage, VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1,
+                                                      VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                                      VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+      vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &depthToRead);
+
+      beginPassTiming(commandBuffer, "depthPyramid");
+      buildDepthPyramid(commandBuffer);
+      endPassTiming(commandBuffer);
+
+      beginPassTiming(commandBuffer, "cullLate");
+      dispatchCull(commandBuffer, true);
+      endPassTiming(commandBuffer);
+      cmdMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+      cmdMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT); // Contadores
+
+      VkImageMemoryBarrier depthToAttachment = imageBarrier(depthImage, VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1,
+                                                            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                                                            VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+      vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT, 0, 0, nullptr, 0, nullptr, 1, &depthToAttachment);
+
+      beginPassTiming(commandBuffer, "drawLate");
+      beginScenePass(commandBuffer, renderPassLate, imageIndex);
+      cmdDrawIndirect(commandBuffer, drawCommandBuffer, objectCount * sizeof(VkDrawIndirectCommand), objectCount);
+      vkCmdEndRenderPass(commandBuffer);
+      endPassTiming(commandBuffer);
+    }
+    void dispatchCull (VkCommandBuffer commandBuffer, bool late)
+    {
+      CullParams params {};
+      params.viewProjection = viewProjection;
+      params.objectCount = static_cast<uint32_t>(sceneObjects.size());
+      params.late = late ? 1 : 0;
+      params.counterSlot = currentFrame;
+
+      cmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+      vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &cullSet, 0, nullptr);
+      vkCmdPushConstants(commandBuffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+      vkCmdDispatch(commandBuffer, (params.objectCount + 63) / 64, 1, 1); // local_size_x = 64
+    }
+    void buildDepthPyramid (VkCommandBuffer commandBuffer)
+    {
+      // La piramide ya esta en GENERAL desde que se creo, y la barrera del inicio del frame espera a que
+      // el culling tardio del frame anterior termine de leerla
+
+      cmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pyramidPipeline);
+      for(uint32_t level = 0; level < depthPyramidLevels; level++)
+      {
+        uint32_t width = std::max(1u, depthPyramidExtent.width >> level);
+        uint32_t height = std::max(1u, depthPyramidExtent.height >> level);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pyramidPipelineLayout, 0, 1, &pyramidSets[level], 0, nullptr);
+        vkCmdDispatch(commandBuffer, (width + 7) / 8, (height + 7) / 8, 1); // local_size 8x8
+
+        // El nivel siguiente (o el culling, si es el ultimo) lee lo que se acaba de escribir
+        VkImageMemoryBarrier levelDone = imageBarrier(depthPyramid, VK_IMAGE_ASPECT_COLOR_BIT, level, 1,
+                                                      VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &levelDone);
+      }
+    }
+    VkImageMemoryBarrier imageBarrier (VkImage image, VkImageAspectFlags aspect, uint32_t baseMipLevel, uint32_t levelCount, VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccess, VkAccessFlags dstAccess)
+    {
+      VkImageMemoryBarrier barrier {};
+      barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+      barrier.srcAccessMask = srcAccess;
+      barrier.dstAccessMask = dstAccess;
+      barrier.oldLayout = oldLayout;
+      barrier.newLayout = newLayout;
+      barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      barrier.image = image;
+      barrier.subresourceRange.aspectMask = aspect;
+      barrier.subresourceRange.baseMipLevel = baseMipLevel;
+      barrier.subresourceRange.levelCount = levelCount;
+      barrier.subresourceRange.baseArrayLayer = 0;
+      barrier.subresourceRange.layerCount = 1;
+      return barrier;
+    }
+    void cmdMemoryBarrier (VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage, VkAccessFlags srcAccess, VkAccessFlags dstAccess)
+    {
+      VkMemoryBarrier barrier {};
+      barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+      barrier.srcAccessMask = srcAccess;
+      barrier.dstAccessMask = dstAccess;
+      vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
     }
     void createSyncObjects (void)
     {
+      TraceScope scope(trace, __func__);
       sImagesAvailable.resize(MAX_FRAMES_IN_FLIGHT);
       sRendersFinished.resize(MAX_FRAMES_IN_FLIGHT);
       fFramesEnded.resize(MAX_FRAMES_IN_FLIGHT);
@@ -660,6 +1687,137 @@ class VkApp
         }
       }
     }
+    void createQueryPool (void)
+    {
+      TraceScope scope(trace, __func__);
+      VkPhysicalDeviceProperties properties;
+      vkGetPhysicalDeviceProperties(graphicsCard, &properties);
+      uint32_t queueFamilyCount = 0;
+      vkGetPhysicalDeviceQueueFamilyProperties(graphicsCard, &queueFamilyCount, nullptr);
+      std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+      vkGetPhysicalDeviceQueueFamilyProperties(graphicsCard, &queueFamilyCount, queueFamilies.data());
+
+      uint32_t validBits = queueFamilies[queueIndices.graphicsQueue.value()].timestampValidBits;
+      timestampPeriod = properties.limits.timestampPeriod;
+      timestampsSupported = validBits > 0 && timestampPeriod > 0.0f;
+      timestampMask = validBits >= 64 ? std::numeric_limits<uint64_t>::max() : (uint64_t(1) << validBits) - 1;
+      timedPasses.resize(MAX_FRAMES_IN_FLIGHT);
+      if(!timestampsSupported)
+      {
+        std::cout << "La cola grafica no soporta timestamps, no se mediran tiempos de GPU por pasada" << std::endl;
+        return;
+      }
+
+      VkQueryPoolCreateInfo createInfo {};
+      createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+      createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+      createInfo.queryCount = MAX_FRAMES_IN_FLIGHT * MAX_TIMED_PASSES * 2; // Inicio y fin de cada pasada, por frame en vuelo
+      if(vkCreateQueryPool(device, &createInfo, nullptr, &timestampPool) != VK_SUCCESS) throw std::runtime_error("ERROR: No se pudo crear la query pool de timestamps...");
+    }
+    void resetPassTimings (VkCommandBuffer commandBuffer)
+    {
+      timedPasses[currentFrame].clear();
+      if(timestampsSupported) vkCmdResetQueryPool(commandBuffer, timestampPool, currentFrame * MAX_TIMED_PASSES * 2, MAX_TIMED_PASSES * 2);
+    }
+    void beginPassTiming (VkCommandBuffer commandBuffer, const std::string& name)
+    {
+      if(!timestampsSupported) return;
+      auto& passes = timedPasses[currentFrame];
+      if(passes.size() >= MAX_TIMED_PASSES) throw std::runtime_error("ERROR: Demasiadas pasadas medidas en un frame (ver MAX_TIMED_PASSES)...");
+      vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampPool, (currentFrame * MAX_TIMED_PASSES + passes.size()) * 2);
+      passes.push_back(name);
+    }
+    void endPassTiming (VkCommandBuffer commandBuffer)
+    {
+      if(!timestampsSupported) return;
+      auto& passes = timedPasses[currentFrame];
+      vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool, (currentFrame * MAX_TIMED_PASSES + passes.size() - 1) * 2 + 1);
+    }
+    void collectPassTimings (uint32_t frame)
+    {
+      const auto& passes = timedPasses[frame];
+      if(!timestampsSupported || passes.empty()) return;
+
+      std::vector<uint64_t> results(passes.size() * 2);
+      if(vkGetQueryPoolResults(device, timestampPool, frame * MAX_TIMED_PASSES * 2, static_cast<uint32_t>(results.size()), results.size() * sizeof(uint64_t), results.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) return;
+
+      std::vector<EngineStats::PassTiming> timings;
+      for(size_t i = 0; i < passes.size(); i++)
+      {
+        uint64_t ticks = (results[i * 2 + 1] & timestampMask) - (results[i * 2] & timestampMask);
+        timings.push_back({ passes[i], ticks * timestampPeriod / 1e6 });
+      }
+      stats.setPassTimings(std::move(timings));
+    }
+    // Envuelven los vkCmd* para contar binds, draws y triangulos del frame
+    void cmdBindPipeline (VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipeline pipeline)
+    {
+      vkCmdBindPipeline(commandBuffer, bindPoint, pipeline);
+      frameCounters.pipelineBinds++;
+    }
+    void cmdDraw (VkCommandBuffer commandBuffer, uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance)
+    {
+      vkCmdDraw(commandBuffer, vertexCount, instanceCount, firstVertex, firstInstance);
+      frameCounters.draws++;
+      frameCounters.triangles += static_cast<uint64_t>(vertexCount / 3) * instanceCount; // Solo TRIANGLE_LIST por ahora
+    }
+    void cmdDrawIndirect (VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, uint32_t drawCount)
+    {
+      if(multiDrawIndirectSupported)
+      {
+        vkCmdDrawIndirect(commandBuffer, buffer, offset, drawCount, sizeof(VkDrawIndirectCommand));
+      } else {
+        for(uint32_t i = 0; i < drawCount; i++) vkCmdDrawIndirect(commandBuffer, buffer, offset + i * sizeof(VkDrawIndirectCommand), 1, sizeof(VkDrawIndirectCommand));
+      }
+      // Los slots que el culling dejo con instanceCount = 0 no dibujan nada: draws y triangulos los cuenta el shader
+    }
+    void collectCullCounters (uint32_t frame)
+    {
+      // Lo que dejo el ultimo frame que uso este slot, MAX_FRAMES_IN_FLIGHT frames atras
+      frameCounters.draws += cullCounters[frame * 2];
+      frameCounters.triangles += cullCounters[frame * 2 + 1];
+    }
+    void updateStats (void)
+    {
+      auto now = std::chrono::steady_clock::now();
+      stats.endFrame(std::chrono::duration<double, std::milli>(now - lastFrameTime).count(), frameCounters);
+      lastFrameTime = now;
+
+      if(glfwGetTime() - lastStatsRefresh < STATS_REFRESH) return;
+      lastStatsRefresh = glfwGetTime();
+      queryMemoryBudget();
+      if(overlayEnabled) glfwSetWindowTitle(window, (std::string(WINDOW_TITLE) + " | " + stats.summary()).c_str());
+    }
+    void queryMemoryBudget (void)
+    {
+      VkPhysicalDeviceMemoryBudgetPropertiesEXT budget {};
+      budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+      VkPhysicalDeviceMemoryProperties2 properties {};
+      properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+      if(memoryBudgetSupported)
+      {
+        properties.pNext = &budget;
+        vkGetPhysicalDeviceMemoryProperties2(graphicsCard, &properties);
+      } else {
+        vkGetPhysicalDeviceMemoryProperties(graphicsCard, &properties.memoryProperties);
+      }
+
+      std::vector<EngineStats::HeapInfo> heaps;
+      for(uint32_t i = 0; i < properties.memoryProperties.memoryHeapCount; i++)
+      {
+        const VkMemoryHeap& heap = properties.memoryProperties.memoryHeaps[i];
+        bool deviceLocal = heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+        if(memoryBudgetSupported) heaps.push_back({ heap.size, budget.heapUsage[i], budget.heapBudget[i], deviceLocal });
+        else heaps.push_back({ heap.size, 0, heap.size, deviceLocal });
+      }
+      stats.setHeaps(std::move(heaps), memoryBudgetSupported);
+    }
+    void toggleOverlay (void)
+    {
+      overlayEnabled = !overlayEnabled;
+      if(overlayEnabled) lastStatsRefresh = 0.0; // Fuerza a actualizar el titulo en el proximo frame
+      else glfwSetWindowTitle(window, WINDOW_TITLE);
+    }
     void recreateSwapchain (void)
     {
       vkDeviceWaitIdle(device);
@@ -667,6 +1825,8 @@ class VkApp
       cleanupSwapchain();
       createSwapChain();
       createImageViews();
+      createDepthResources();
+      if(OCCLUSION_CULLING) createDepthPyramid();
       createFramebuffers();
       // Quiza en el futuro se deba recrear el render pass
     }
@@ -674,6 +1834,17 @@ class VkApp
     {
       for(auto framebuffer : swapChainFramebuffers) vkDestroyFramebuffer(device, framebuffer, nullptr);
       for(auto imageView : imageViews) vkDestroyImageView(device, imageView, nullptr);
+      vkDestroyImageView(device, depthImageView, nullptr);
+      vkDestroyImage(device, depthImage, nullptr);
+      vkFreeMemory(device, depthImageMemory, nullptr);
+      if(OCCLUSION_CULLING)
+      {
+        vkDestroyDescriptorPool(device, occlusionDescriptorPool, nullptr); // Libera tambien los descriptor sets
+        for(auto mipView : depthPyramidMips) vkDestroyImageView(device, mipView, nullptr);
+        vkDestroyImageView(device, depthPyramidView, nullptr);
+        vkDestroyImage(device, depthPyramid, nullptr);
+        vkFreeMemory(device, depthPyramidMemory, nullptr);
+      }
       vkDestroySwapchainKHR(device, swapChain, nullptr);
     }
     static std::vector<char> readShader (const std::string& filename)
@@ -682,8 +1853,6 @@ class VkApp
       if(!file.is_open()) throw std::runtime_error("ERROR: No se pudo abrir el shader " + filename);
       size_t fileSize = (size_t) file.tellg();
       std::vector <char> buffer(fileSize);
-      
-      std::cout << filename << " size is: " << fileSize << "bytes." << std::endl;
 
       file.seekg(0); //Ir al inicio del archivo
       file.read(buffer.data(), fileSize);
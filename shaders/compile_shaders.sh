@@ -1,3 +1,5 @@
 #!/bin/bash
 glslc shader.vert -o compiled/vert.spv
 glslc shader.frag -o compiled/frag.spv
+glslc depth_pyramid.comp -o compiled/depth_pyramid.spv
+glslc occlusion_cull.comp -o compiled/occlusion_cull.spv